@@ -0,0 +1,94 @@
+﻿/*
+ * AufBauWerk Erweiterungen für Vivendi
+ * Copyright (C) 2024  Manuel Meitinger
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+using System.Collections.Concurrent;
+using System.Diagnostics;
+using System.Text.Json.Nodes;
+
+namespace AufBauWerk.Vivendi.Bench;
+
+internal static class OpenOlatStub
+{
+    public static async Task<int> RunAsync(Uri stubUrl, Uri olatAuthUrl, string userName, string password, int logins, TimeSpan latency)
+    {
+        ConcurrentDictionary<string, int> calls = new();
+        ConcurrentDictionary<string, JsonObject> users = new();
+        long nextKey = 0;
+
+        WebApplicationBuilder builder = WebApplication.CreateSlimBuilder();
+        builder.Logging.ClearProviders();
+        builder.WebHost.UseUrls(stubUrl.GetLeftPart(UriPartial.Authority));
+        await using WebApplication app = builder.Build();
+        app.Use(async (context, next) =>
+        {
+            // count per route and simulate the round trip to a remote OpenOlat
+            string route = (context.GetEndpoint() as RouteEndpoint)?.RoutePattern.RawText ?? context.Request.Path;
+            calls.AddOrUpdate($"{context.Request.Method} {route}", 1, (_, count) => count + 1);
+            await Task.Delay(latency);
+            await next(context);
+        });
+        RouteGroupBuilder api = app.MapGroup(stubUrl.AbsolutePath.TrimEnd('/'));
+        api.MapGet("users", (string externalId) => Results.Json(users.TryGetValue(externalId, out JsonObject? user) ? new JsonArray(user.DeepClone()) : new JsonArray()));
+        api.MapPut("users", async (HttpRequest request) =>
+        {
+            JsonObject user = (await request.ReadFromJsonAsync<JsonObject>())!;
+            long key = Interlocked.Increment(ref nextKey);
+            user["key"] = key;
+            users[(string)user["externalId"]!] = user;
+            return Results.Json(new { key });
+        });
+        api.MapPost("users/{key:long}", async (long key, HttpRequest request) =>
+        {
+            JsonObject user = (await request.ReadFromJsonAsync<JsonObject>())!;
+            users[(string)user["externalId"]!] = user;
+            return Results.Ok();
+        });
+        api.MapPut("users/{key:long}/authentications", (long key) => Results.Ok());
+        api.MapPost("users/{key:long}/portrait", (long key) => Results.Ok());
+        api.MapDelete("users/{key:long}/portrait", (long key) => Results.NotFound());
+        await app.StartAsync();
+
+        using HttpClient client = new() { BaseAddress = olatAuthUrl };
+        List<double> times = [];
+        for (int i = 0; i < logins; i++)
+        {
+            Stopwatch stopwatch = Stopwatch.StartNew();
+            using HttpResponseMessage response = await client.PostAsync("/openolat/authenticate", new FormUrlEncodedContent(new Dictionary<string, string>()
+            {
+                ["username"] = userName,
+                ["password"] = password,
+            }));
+            stopwatch.Stop();
+            times.Add(stopwatch.Elapsed.TotalMilliseconds);
+            Console.WriteLine($"login #{i + 1}: {(int)response.StatusCode} in {stopwatch.Elapsed.TotalMilliseconds:F1} ms");
+        }
+
+        // give background updates (portraits) a chance to finish before counting
+        await Task.Delay(TimeSpan.FromSeconds(2));
+        int total = calls.Values.Sum();
+        Console.WriteLine($"logins: {logins}, latency per call: {latency.TotalMilliseconds} ms");
+        Console.WriteLine($"first login: {times.FirstOrDefault():F1} ms, following logins: {(times.Count > 1 ? times.Skip(1).Average() : 0):F1} ms average");
+        Console.WriteLine($"REST calls: {total} total, {(double)total / Math.Max(1, logins):F2} per login");
+        foreach ((string route, int count) in calls.OrderBy(entry => entry.Key))
+        {
+            Console.WriteLine($"  {route}: {count}");
+        }
+        await app.StopAsync();
+        return 0;
+    }
+}
@@ -0,0 +1,56 @@
+﻿/*
+ * AufBauWerk Erweiterungen für Vivendi
+ * Copyright (C) 2024  Manuel Meitinger
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Measurement harness with local stand-ins, run on the Windows host:
+//   openolat <stub-url> <olatauth-url> <username> <password> [logins] [latency-ms]
+//     Serves a stub OpenOlat REST API at <stub-url> (configure it as OlatAuth:RestApiEndpoint),
+//     logs in through OlatAuth repeatedly and prints the login latency and the REST calls per login.
+//   remoteapp [requests] [concurrency] [instances] [connections] [latency-ms]
+//     Sends RemoteApp requests to a stand-in Syncer, first one connection per request like before the channel,
+//     then multiplexed over RemoteAppChannel, and prints the throughput of both. Stop VivendiSyncer beforehand.
+
+using AufBauWerk.Vivendi.Bench;
+
+return args switch
+{
+    ["openolat", string stubUrl, string olatAuthUrl, string userName, string password, .. string[] rest] => await OpenOlatStub.RunAsync
+    (
+        stubUrl: new(stubUrl),
+        olatAuthUrl: new(olatAuthUrl),
+        userName: userName,
+        password: password,
+        logins: rest.Length > 0 ? int.Parse(rest[0]) : 20,
+        latency: TimeSpan.FromMilliseconds(rest.Length > 1 ? int.Parse(rest[1]) : 50)
+    ),
+    ["remoteapp", .. string[] rest] => await RemoteAppLoad.RunAsync
+    (
+        requests: rest.Length > 0 ? int.Parse(rest[0]) : 1000,
+        concurrency: rest.Length > 1 ? int.Parse(rest[1]) : 16,
+        instances: rest.Length > 2 ? int.Parse(rest[2]) : 4,
+        connections: rest.Length > 3 ? int.Parse(rest[3]) : 4,
+        latency: TimeSpan.FromMilliseconds(rest.Length > 4 ? int.Parse(rest[4]) : 20)
+    ),
+    _ => Usage(),
+};
+
+static int Usage()
+{
+    Console.Error.WriteLine("usage: VivendiBench openolat <stub-url> <olatauth-url> <username> <password> [logins] [latency-ms]");
+    Console.Error.WriteLine("       VivendiBench remoteapp [requests] [concurrency] [instances] [connections] [latency-ms]");
+    return 1;
+}
@@ -0,0 +1,106 @@
+﻿/*
+ * AufBauWerk Erweiterungen für Vivendi
+ * Copyright (C) 2024  Manuel Meitinger
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+using System.Diagnostics;
+using System.IO.Pipes;
+using System.Security.Principal;
+using System.Text.Json;
+
+namespace AufBauWerk.Vivendi.Bench;
+
+internal static class RemoteAppLoad
+{
+    private const string LegacyPipeName = "VivendiBenchLegacy";
+
+    private sealed class ChannelServer(ILoggerFactory loggerFactory, int instances, int concurrency, TimeSpan latency) : Syncer.ChannelService("VivendiRemoteApp", instances, concurrency, loggerFactory.CreateLogger<Syncer.ChannelService>())
+    {
+        protected override IdentityReference ClientIdentity => WindowsIdentity.GetCurrent().User!;
+
+        protected override async Task<Syncer.Result> ExecuteAsync(Syncer.ExternalUser externalUser, CancellationToken stoppingToken)
+        {
+            await Task.Delay(latency, stoppingToken);
+            return new Syncer.Credential() { UserName = externalUser.UserName, Password = "bench" };
+        }
+    }
+
+    private sealed class LegacyServer(ILoggerFactory loggerFactory, TimeSpan latency) : Syncer.PipeService(LegacyPipeName, PipeDirection.InOut, loggerFactory.CreateLogger<Syncer.PipeService>())
+    {
+        protected override IdentityReference ClientIdentity => WindowsIdentity.GetCurrent().User!;
+
+        protected override async Task<Syncer.Result> ExecuteAsync(NamedPipeServerStream stream, CancellationToken stoppingToken)
+        {
+            Syncer.ExternalUser externalUser = await Syncer.Extensions.ReceiveMessageAsync(stream, Syncer.SerializerContext.Default.ExternalUser, stoppingToken) ?? throw new InvalidDataException();
+            await Task.Delay(latency, stoppingToken);
+            return new Syncer.Credential() { UserName = externalUser.UserName, Password = "bench" };
+        }
+    }
+
+    private static Gateway.ExternalUser CreateUser(long i) => new() { UserName = $"bench{i}@example.org", KnownFolders = [] };
+
+    private static async Task<Gateway.Result> SendLegacyAsync(Gateway.ExternalUser externalUser, CancellationToken cancellationToken)
+    {
+        // what the Gateway did before the channel: one connection per request
+        byte[] message = JsonSerializer.SerializeToUtf8Bytes(externalUser, Gateway.SerializerContext.Default.ExternalUser);
+        using NamedPipeClientStream stream = new(".", LegacyPipeName, PipeDirection.InOut, PipeOptions.Asynchronous, TokenImpersonationLevel.Identification, HandleInheritability.None);
+        await stream.ConnectAsync(cancellationToken);
+        await stream.WriteAsync(message, cancellationToken);
+        return await JsonSerializer.DeserializeAsync(stream, Gateway.SerializerContext.Default.Result, cancellationToken) ?? throw new InvalidDataException();
+    }
+
+    private static async Task MeasureAsync(string label, int requests, int concurrency, Func<Gateway.ExternalUser, CancellationToken, Task<Gateway.Result?>> send)
+    {
+        int failed = 0;
+        List<double> times = [];
+        Stopwatch total = Stopwatch.StartNew();
+        await Parallel.ForEachAsync(Enumerable.Range(0, requests), new ParallelOptions() { MaxDegreeOfParallelism = concurrency }, async (i, cancellationToken) =>
+        {
+            Stopwatch stopwatch = Stopwatch.StartNew();
+            try
+            {
+                Gateway.Result? result = await send(CreateUser(i), cancellationToken);
+                if (result?.Credential is null) { Interlocked.Increment(ref failed); }
+            }
+            catch (Exception ex) when (ex is IOException or TimeoutException or InvalidDataException)
+            {
+                Interlocked.Increment(ref failed);
+            }
+            stopwatch.Stop();
+            lock (times) { times.Add(stopwatch.Elapsed.TotalMilliseconds); }
+        });
+        total.Stop();
+        times.Sort();
+        Console.WriteLine($"{label}: {requests} requests in {total.Elapsed.TotalSeconds:F2} s = {requests / total.Elapsed.TotalSeconds:F1} req/s, p50 {times[times.Count / 2]:F1} ms, p99 {times[Math.Min(times.Count - 1, times.Count * 99 / 100)]:F1} ms, {failed} failed");
+    }
+
+    public static async Task<int> RunAsync(int requests, int concurrency, int instances, int connections, TimeSpan latency)
+    {
+        using ILoggerFactory loggerFactory = LoggerFactory.Create(builder => builder.AddSimpleConsole().SetMinimumLevel(LogLevel.Warning));
+        using LegacyServer legacyServer = new(loggerFactory, latency);
+        await legacyServer.StartAsync(CancellationToken.None);
+        await MeasureAsync("legacy ", requests, concurrency, async (user, cancellationToken) => await SendLegacyAsync(user, cancellationToken));
+        await legacyServer.StopAsync(CancellationToken.None);
+
+        using ChannelServer channelServer = new(loggerFactory, instances, concurrency, latency);
+        await channelServer.StartAsync(CancellationToken.None);
+        IConfiguration configuration = new ConfigurationBuilder().AddInMemoryCollection(new Dictionary<string, string?>() { ["Gateway:RemoteAppConnections"] = connections.ToString() }).Build();
+        using Gateway.RemoteAppChannel channel = new(loggerFactory.CreateLogger<Gateway.RemoteAppChannel>(), configuration);
+        await MeasureAsync("channel", requests, concurrency, channel.SendAsync);
+        await channelServer.StopAsync(CancellationToken.None);
+        return 0;
+    }
+}
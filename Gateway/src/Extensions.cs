@@ -17,9 +17,6 @@
  */
 
 using Microsoft.AspNetCore.Authorization;
-using System.IO.Pipes;
-using System.Security.Principal;
-using System.Text.Json;
 
 namespace AufBauWerk.Vivendi.Gateway;
 
@@ -27,7 +24,7 @@ internal static partial class Extensions
 {
     public static RouteHandlerBuilder MapRemoteAppApi(this IEndpointRouteBuilder app)
     {
-        return app.MapPost("/gateway/remoteapp", [Authorize] async (HttpContext context, RdpFile rdpFile) =>
+        return app.MapPost("/gateway/remoteapp", [Authorize] async (HttpContext context, RdpFile rdpFile, RemoteAppChannel channel) =>
         {
             // verify the request data
             if (context.User?.Identity?.Name is not string userName) { return Results.Challenge(); }
@@ -35,15 +32,10 @@ public static RouteHandlerBuilder MapRemoteAppApi(this IEndpointRouteBuilder app
             if (request is null) { return Results.BadRequest(); }
             if (!request.KnownFolders.Values.All(Path.IsPathFullyQualified)) { return Results.BadRequest(); }
             ExternalUser externalUser = new() { UserName = userName, KnownFolders = request.KnownFolders };
-            byte[] message = JsonSerializer.SerializeToUtf8Bytes(externalUser, SerializerContext.Default.ExternalUser);
-            if (64 * 1024 < message.Length) { return Results.BadRequest(); }
 
             // retrieve the RDP file and credential
             byte[] rdpFileContent = await rdpFile.GetContentAsync(context.RequestAborted);
-            using NamedPipeClientStream stream = new(".", "VivendiRemoteApp", PipeDirection.InOut, PipeOptions.Asynchronous, TokenImpersonationLevel.Identification, HandleInheritability.None);
-            await stream.ConnectAsync(context.RequestAborted);
-            await stream.WriteAsync(message, context.RequestAborted);
-            Result result = await JsonSerializer.DeserializeAsync(stream, SerializerContext.Default.Result, context.RequestAborted) ?? throw new InvalidDataException();
+            if (await channel.SendAsync(externalUser, context.RequestAborted) is not Result result) { return Results.BadRequest(); }
             if (result.Error is not null) { return Results.InternalServerError(); }
             if (result.Credential is null) { return Results.Forbid(); }
 
@@ -28,6 +28,7 @@
 builder.Services
     .AddWindowsService(options => options.ServiceName = "VivendiGateway")
     .AddSingleton<RdpFile>()
+    .AddSingleton<RemoteAppChannel>()
     .AddAuthorization()
     .AddAuthentication(JwtBearerDefaults.AuthenticationScheme)
     .AddMicrosoftIdentityWebApi(builder.Configuration);
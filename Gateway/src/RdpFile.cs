@@ -18,21 +18,66 @@
 
 namespace AufBauWerk.Vivendi.Gateway;
 
-public class RdpFile(ILogger<RdpFile> logger)
+public class RdpFile : IDisposable
 {
-    private readonly string path = Path.Combine(AppContext.BaseDirectory, "vivendi.rdp");
-    private (DateTime, byte[])? cache = null;
+    private const string FileName = "vivendi.rdp";
+
+    private readonly ILogger<RdpFile> logger;
+    private readonly string path = Path.Combine(AppContext.BaseDirectory, FileName);
+    private readonly FileSystemWatcher watcher;
+    private volatile byte[]? cache = null;
+    private int version = 0;
+
+    public RdpFile(ILogger<RdpFile> logger)
+    {
+        this.logger = logger;
+        watcher = new(AppContext.BaseDirectory, FileName)
+        {
+            NotifyFilter = NotifyFilters.FileName | NotifyFilters.LastWrite | NotifyFilters.Size | NotifyFilters.CreationTime,
+        };
+        watcher.Changed += (sender, e) => Invalidate();
+        watcher.Created += (sender, e) => Invalidate();
+        watcher.Deleted += (sender, e) => Invalidate();
+        watcher.Renamed += (sender, e) => Invalidate();
+        watcher.Error += (sender, e) =>
+        {
+            // events might have been lost, so don't trust the cache
+            logger.LogWarning(e.GetException(), "Watching RDP file failed: {Message}", e.GetException().Message);
+            Invalidate();
+        };
+        watcher.EnableRaisingEvents = true;
+    }
+
+    private void Invalidate()
+    {
+        Interlocked.Increment(ref version);
+        cache = null;
+    }
+
+    public void Dispose()
+    {
+        GC.SuppressFinalize(this);
+        watcher.Dispose();
+    }
 
     public async Task<byte[]> GetContentAsync(CancellationToken cancellationToken)
     {
-        DateTime time = File.GetLastWriteTimeUtc(path);
-        if (cache is (DateTime cacheTime, byte[] cacheContent) && time == cacheTime)
+        if (cache is byte[] cacheContent)
         {
             return cacheContent;
         }
+        int currentVersion = Volatile.Read(ref version);
         byte[] content = await File.ReadAllBytesAsync(path, cancellationToken);
-        cache = (time, content);
-        logger.LogInformation("Cached RDP file of {Length} bytes.", content.Length);
+        cache = content;
+        if (Volatile.Read(ref version) != currentVersion)
+        {
+            // changed while reading, read again next time
+            cache = null;
+        }
+        else
+        {
+            logger.LogInformation("Cached RDP file of {Length} bytes.", content.Length);
+        }
         return content;
     }
 }
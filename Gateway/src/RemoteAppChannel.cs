@@ -0,0 +1,189 @@
+﻿/*
+ * AufBauWerk Erweiterungen für Vivendi
+ * Copyright (C) 2024  Manuel Meitinger
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+using System.Collections.Concurrent;
+using System.IO.Pipes;
+using System.Security.Principal;
+using System.Text.Json;
+
+namespace AufBauWerk.Vivendi.Gateway;
+
+internal sealed class RemoteAppChannel(ILogger<RemoteAppChannel> logger, IConfiguration configuration) : IDisposable
+{
+    private const int ConnectTimeout = 5000;
+    private const int MaxMessageSize = 64 * 1024;
+    private const string PipeName = "VivendiRemoteApp";
+    private const int RequestTimeout = 60000;
+    private static readonly TimeSpan RetryConnectDelay = TimeSpan.FromSeconds(30);
+
+    private sealed class Connection(Slot slot, NamedPipeClientStream stream)
+    {
+        public volatile bool IsClosed;
+        public ConcurrentDictionary<long, TaskCompletionSource<Result>> Pending { get; } = new();
+        public Slot Slot => slot;
+        public NamedPipeClientStream Stream => stream;
+        public SemaphoreSlim WriteLock { get; } = new(1);
+    }
+
+    private sealed class Slot(int index)
+    {
+        public Connection? Connection;
+        public SemaphoreSlim ConnectLock { get; } = new(1);
+        public int Index => index;
+        public long RetryConnectTicks;
+    }
+
+    // should not exceed Syncer:RemoteAppInstances, otherwise the surplus connections never get a pipe instance
+    private readonly Slot[] slots = [.. Enumerable.Range(0, Math.Max(1, configuration.GetValue("Gateway:RemoteAppConnections", 4))).Select(index => new Slot(index))];
+    private long nextId = 0;
+    private int nextIndex = 0;
+
+    private async Task<Connection> ConnectAsync(Slot slot, CancellationToken cancellationToken)
+    {
+        await slot.ConnectLock.WaitAsync(cancellationToken);
+        try
+        {
+            Connection? connection = slot.Connection;
+            if (connection is not null) { return connection; }
+            NamedPipeClientStream stream = new(".", PipeName, PipeDirection.InOut, PipeOptions.Asynchronous, TokenImpersonationLevel.Identification, HandleInheritability.None);
+            try
+            {
+                await stream.ConnectAsync(ConnectTimeout, cancellationToken);
+                stream.ReadMode = PipeTransmissionMode.Message;
+            }
+            catch
+            {
+                stream.Dispose();
+                throw;
+            }
+            connection = new(slot, stream);
+            Volatile.Write(ref slot.Connection, connection);
+            logger.LogInformation("Connected channel #{Index} to named pipe '{Pipe}'.", slot.Index, PipeName);
+            _ = Task.Run(() => ReceiveAsync(connection));
+            return connection;
+        }
+        finally
+        {
+            slot.ConnectLock.Release();
+        }
+    }
+
+    private Connection? GetAnyConnection() => slots.Select(slot => Volatile.Read(ref slot.Connection)).FirstOrDefault(connection => connection is not null);
+
+    private async Task<Connection> GetConnectionAsync(CancellationToken cancellationToken)
+    {
+        Slot slot = slots[(int)((uint)Interlocked.Increment(ref nextIndex) % (uint)slots.Length)];
+        Connection? connection = Volatile.Read(ref slot.Connection);
+        if (connection is not null) { return connection; }
+
+        // don't wait for a slot that failed recently as long as another one is usable
+        if (DateTime.UtcNow.Ticks < Interlocked.Read(ref slot.RetryConnectTicks) && GetAnyConnection() is Connection fallback) { return fallback; }
+        try
+        {
+            return await ConnectAsync(slot, cancellationToken);
+        }
+        catch (Exception ex) when ((ex is TimeoutException or IOException) && !cancellationToken.IsCancellationRequested)
+        {
+            Interlocked.Exchange(ref slot.RetryConnectTicks, (DateTime.UtcNow + RetryConnectDelay).Ticks);
+            if (GetAnyConnection() is not Connection other) { throw; }
+            logger.LogWarning(ex, "Connect channel #{Index} to named pipe '{Pipe}' failed, using channel #{Fallback} instead. Make sure Gateway:RemoteAppConnections does not exceed Syncer:RemoteAppInstances. {Message}", slot.Index, PipeName, other.Slot.Index, ex.Message);
+            return other;
+        }
+    }
+
+    private async Task ReceiveAsync(Connection connection)
+    {
+        Exception error;
+        try
+        {
+            using MemoryStream message = new();
+            byte[] buffer = new byte[4096];
+            while (true)
+            {
+                message.SetLength(0);
+                do
+                {
+                    int read = await connection.Stream.ReadAsync(buffer);
+                    if (read is 0) { throw new EndOfStreamException(); }
+                    message.Write(buffer, 0, read);
+                } while (!connection.Stream.IsMessageComplete);
+                ChannelResponse response = JsonSerializer.Deserialize(message.GetBuffer().AsSpan(0, (int)message.Length), SerializerContext.Default.ChannelResponse) ?? throw new InvalidDataException();
+                if (connection.Pending.TryRemove(response.Id, out TaskCompletionSource<Result>? completion))
+                {
+                    completion.TrySetResult(response.Result);
+                }
+            }
+        }
+        catch (Exception ex) { error = ex; }
+
+        // the next request will open a new connection, fail everything still waiting on this one
+        connection.IsClosed = true;
+        Interlocked.CompareExchange(ref connection.Slot.Connection, null, connection);
+        connection.Stream.Dispose();
+        logger.LogWarning(error, "Channel #{Index} to named pipe '{Pipe}' closed: {Message}", connection.Slot.Index, PipeName, error.Message);
+        foreach (long id in connection.Pending.Keys)
+        {
+            if (connection.Pending.TryRemove(id, out TaskCompletionSource<Result>? completion))
+            {
+                completion.TrySetException(new IOException("Channel closed.", error));
+            }
+        }
+    }
+
+    public void Dispose()
+    {
+        foreach (Slot slot in slots)
+        {
+            Interlocked.Exchange(ref slot.Connection, null)?.Stream.Dispose();
+            slot.ConnectLock.Dispose();
+        }
+    }
+
+    public async Task<Result?> SendAsync(ExternalUser externalUser, CancellationToken cancellationToken)
+    {
+        long id = Interlocked.Increment(ref nextId);
+        byte[] message = JsonSerializer.SerializeToUtf8Bytes(new ChannelRequest() { Id = id, User = externalUser }, SerializerContext.Default.ChannelRequest);
+        if (MaxMessageSize < message.Length)
+        {
+            // the Syncer would reject it anyway
+            return null;
+        }
+        Connection connection = await GetConnectionAsync(cancellationToken);
+        TaskCompletionSource<Result> completion = new(TaskCreationOptions.RunContinuationsAsynchronously);
+        connection.Pending[id] = completion;
+        try
+        {
+            if (connection.IsClosed) { throw new IOException("Channel closed."); }
+            await connection.WriteLock.WaitAsync(cancellationToken);
+            try
+            {
+                // never cancel a write halfway, that would break the message framing for everyone else
+                await connection.Stream.WriteAsync(message, CancellationToken.None);
+            }
+            finally
+            {
+                connection.WriteLock.Release();
+            }
+            return await completion.Task.WaitAsync(TimeSpan.FromMilliseconds(RequestTimeout), cancellationToken);
+        }
+        finally
+        {
+            connection.Pending.TryRemove(id, out _);
+        }
+    }
+}
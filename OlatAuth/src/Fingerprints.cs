@@ -0,0 +1,72 @@
+﻿/*
+ * AufBauWerk Erweiterungen für Vivendi
+ * Copyright (C) 2024  Manuel Meitinger
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+using Microsoft.Extensions.Options;
+using System.Collections.Concurrent;
+using System.Security.Cryptography;
+using System.Text.Json;
+
+namespace AufBauWerk.Vivendi.OlatAuth;
+
+public sealed class Fingerprints(IOptions<Settings> options)
+{
+    public sealed record Fingerprint(long IdentityKey, string Profile, string Authentication, string? Portrait);
+
+    private sealed record Entry(Fingerprint Fingerprint, DateTime Expires);
+
+    private readonly ConcurrentDictionary<string, Entry> entries = new();
+
+    public static string Hash(byte[]? data) => data is null ? "" : Convert.ToHexString(SHA256.HashData(data));
+
+    public static string Hash(params string?[] values) => Hash(JsonSerializer.SerializeToUtf8Bytes(values));
+
+    public Fingerprint? Get(string externalId)
+    {
+        if (!entries.TryGetValue(externalId, out Entry? entry)) { return null; }
+        if (entry.Expires < DateTime.UtcNow)
+        {
+            // make sure changes done within OpenOlat get overwritten eventually
+            entries.TryRemove(new(externalId, entry));
+            return null;
+        }
+        return entry.Fingerprint;
+    }
+
+    public void Remove(string externalId) => entries.TryRemove(externalId, out _);
+
+    public void SetPortrait(string externalId, long identityKey, string portrait)
+    {
+        // only update what is already known about the same OpenOlat user
+        if (entries.TryGetValue(externalId, out Entry? entry) && entry.Fingerprint.IdentityKey == identityKey)
+        {
+            entries.TryUpdate(externalId, entry with { Fingerprint = entry.Fingerprint with { Portrait = portrait } }, entry);
+        }
+    }
+
+    public void Set(string externalId, Fingerprint fingerprint, bool renew)
+    {
+        // only a fingerprint that got fully synced with OpenOlat gets a new lifetime
+        DateTime expires = DateTime.UtcNow + options.Value.FingerprintLifetime;
+        entries.AddOrUpdate
+        (
+            externalId,
+            _ => new(fingerprint, renew ? expires : DateTime.UtcNow),
+            (_, entry) => new(fingerprint, renew ? expires : entry.Expires)
+        );
+    }
+}
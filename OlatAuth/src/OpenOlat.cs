@@ -19,19 +19,14 @@
 using Microsoft.AspNetCore.Mvc;
 using Microsoft.Data.SqlClient;
 using Microsoft.Extensions.Options;
-using SixLabors.ImageSharp;
-using SixLabors.ImageSharp.Formats.Jpeg;
-using SixLabors.ImageSharp.Processing;
 using System.Data;
-using System.Net;
-using System.Net.Http.Headers;
 using System.Text.Json;
 using System.Text.Json.Serialization;
 
 namespace AufBauWerk.Vivendi.OlatAuth;
 
 [ApiController]
-public sealed class OpenOlat : ControllerBase, IDisposable
+public sealed class OpenOlat(IOptions<Settings> options, IHttpClientFactory clientFactory, Fingerprints fingerprints, Portraits portraits) : ControllerBase
 {
     private class ManagedUser
     {
@@ -42,7 +37,13 @@ private class ManagedUser
         [JsonPropertyName("lastName")] public string? LastName { get; set; }
         [JsonPropertyName("email")] public string? Email { get; set; }
         [JsonIgnore] public string UserName { get; set; } = "";
-        [JsonIgnore] public Stream? Portrait { get; set; }
+        [JsonIgnore] public byte[]? Portrait { get; set; }
+
+        public string GetAuthenticationHash(string provider) => Fingerprints.Hash(provider, UserName);
+
+        public string GetPortraitHash() => Fingerprints.Hash(Portrait);
+
+        public string GetProfileHash() => Fingerprints.Hash(Login, FirstName, LastName, Email);
 
         public bool NeedsUpdate(ManagedUser user)
         {
@@ -56,49 +57,8 @@ public bool NeedsUpdate(ManagedUser user)
         }
     }
 
-    private readonly HttpClient client;
-    private readonly Settings settings;
-
-    public OpenOlat(IOptions<Settings> options)
-    {
-        settings = options.Value;
-        client = new(new HttpClientHandler() { Credentials = settings.Credentials }) { BaseAddress = settings.RestApiEndpoint };
-        client.DefaultRequestHeaders.Accept.Add(new("application/json"));
-    }
-
-    private async Task<Stream?> CheckPortraitAsync(byte[] data, CancellationToken cancellationToken)
-    {
-        try
-        {
-            MemoryStream inStream = new(data);
-            using Image image = await Image.LoadAsync(inStream, cancellationToken);
-            if (image.Metadata.DecodedImageFormat == JpegFormat.Instance && image.Width <= settings.MaxPortraitSize.Width && image.Height <= settings.MaxPortraitSize.Height)
-            {
-                inStream.Position = 0;
-                return inStream;
-            }
-            image.Mutate(op => op.Resize(new ResizeOptions()
-            {
-                Mode = ResizeMode.Max,
-                Sampler = KnownResamplers.Bicubic,
-                Size = settings.MaxPortraitSize,
-            }));
-            MemoryStream outStream = new();
-            await image.SaveAsJpegAsync(outStream, cancellationToken);
-            outStream.Position = 0;
-            return outStream;
-        }
-        catch (ImageFormatException) { return null; }
-        catch (ImageProcessingException) { return null; }
-    }
-
-    private async Task<bool> DeletePortraitAsync(long identityKey, CancellationToken cancellationToken)
-    {
-        using HttpResponseMessage response = await client.DeleteAsync($"users/{identityKey}/portrait", cancellationToken);
-        if (response.StatusCode is HttpStatusCode.NotFound) { return false; }
-        response.EnsureSuccessStatusCode();
-        return true;
-    }
+    private readonly HttpClient client = clientFactory.CreateClient(nameof(OpenOlat));
+    private readonly Settings settings = options.Value;
 
     private async Task<ManagedUser?> ExecuteQueryAsync(string userName, string password, CancellationToken cancellationToken)
     {
@@ -119,9 +79,7 @@ private async Task<bool> DeletePortraitAsync(long identityKey, CancellationToken
             LastName = (string)reader[nameof(ManagedUser.LastName)],
             Email = (string)reader[nameof(ManagedUser.Email)],
             UserName = userName,
-            Portrait = portrait == DBNull.Value
-                ? null
-                : await CheckPortraitAsync((byte[])portrait, cancellationToken),
+            Portrait = portrait == DBNull.Value ? null : (byte[])portrait,
         };
     }
 
@@ -138,15 +96,6 @@ private async Task PostAuthenticationAsync(long identityKey, string provider, st
         response.EnsureSuccessStatusCode();
     }
 
-    private async Task PostPortraitAsync(long identityKey, Stream portrait, CancellationToken cancellationToken)
-    {
-        using StreamContent imageContent = new(portrait);
-        imageContent.Headers.ContentType = new MediaTypeHeaderValue("image/jpeg");
-        using MultipartFormDataContent postContent = new() { { imageContent, "portrait", "portrait.jpg" } };
-        using HttpResponseMessage response = await client.PostAsync($"users/{identityKey}/portrait", postContent, cancellationToken);
-        response.EnsureSuccessStatusCode();
-    }
-
     private async Task PostUserAsync(ManagedUser user, CancellationToken cancellationToken)
     {
         using HttpResponseMessage response = await client.PostAsJsonAsync($"users/{user.IdentityKey}", user, cancellationToken);
@@ -163,34 +112,59 @@ private async Task<long> PutUserAsync(ManagedUser user, CancellationToken cancel
 
     private async Task UpsertUserAsync(ManagedUser user, CancellationToken cancellationToken)
     {
-        ManagedUser? existingUser = await GetUserAsync(user.ExternalId, cancellationToken);
-        if (existingUser is null)
+        Fingerprints.Fingerprint? known = fingerprints.Get(user.ExternalId);
+        Fingerprints.Fingerprint current = new
+        (
+            IdentityKey: 0,
+            Profile: user.GetProfileHash(),
+            Authentication: user.GetAuthenticationHash(settings.AuthProvider),
+            Portrait: null
+        );
+        if (known is not null && known.Profile == current.Profile)
         {
-            user.IdentityKey = await PutUserAsync(user, cancellationToken);
+            user.IdentityKey = known.IdentityKey;
         }
         else
         {
-            user.IdentityKey = existingUser.IdentityKey;
-            if (existingUser.NeedsUpdate(user))
+            ManagedUser? existingUser = await GetUserAsync(user.ExternalId, cancellationToken);
+            if (existingUser is null)
             {
-                await PostUserAsync(user, cancellationToken);
+                user.IdentityKey = await PutUserAsync(user, cancellationToken);
+            }
+            else
+            {
+                user.IdentityKey = existingUser.IdentityKey;
+                if (existingUser.NeedsUpdate(user))
+                {
+                    await PostUserAsync(user, cancellationToken);
+                }
             }
         }
-        await PostAuthenticationAsync(user.IdentityKey, settings.AuthProvider, user.UserName, credential: null, cancellationToken);
-        if (user.Portrait is null)
+        if (known?.IdentityKey != user.IdentityKey)
         {
-            await DeletePortraitAsync(user.IdentityKey, cancellationToken);
+            // the OpenOlat user got (re-)created, nothing is known about it
+            known = null;
         }
-        else
+        // the portrait hash is set by the background update once it succeeded
+        current = current with { IdentityKey = user.IdentityKey, Portrait = known?.Portrait };
+        if (known?.Authentication != current.Authentication)
         {
-            await PostPortraitAsync(user.IdentityKey, user.Portrait, cancellationToken);
+            try
+            {
+                await PostAuthenticationAsync(user.IdentityKey, settings.AuthProvider, user.UserName, credential: null, cancellationToken);
+            }
+            catch
+            {
+                fingerprints.Remove(user.ExternalId);
+                throw;
+            }
+        }
+        fingerprints.Set(user.ExternalId, current, renew: known is null);
+        string portraitHash = user.GetPortraitHash();
+        if (current.Portrait != portraitHash)
+        {
+            portraits.Enqueue(user.IdentityKey, user.ExternalId, portraitHash, user.Portrait);
         }
-    }
-
-    public void Dispose()
-    {
-        GC.SuppressFinalize(this);
-        client.Dispose();
     }
 
     [HttpPost("/openolat/authenticate")]
@@ -0,0 +1,146 @@
+﻿/*
+ * AufBauWerk Erweiterungen für Vivendi
+ * Copyright (C) 2024  Manuel Meitinger
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+using Microsoft.Extensions.Caching.Memory;
+using Microsoft.Extensions.Options;
+using SixLabors.ImageSharp;
+using SixLabors.ImageSharp.Formats.Jpeg;
+using SixLabors.ImageSharp.Processing;
+using System.Collections.Concurrent;
+using System.Net;
+using System.Net.Http.Headers;
+using System.Threading.Channels;
+
+namespace AufBauWerk.Vivendi.OlatAuth;
+
+public sealed class Portraits(ILogger<Portraits> logger, IOptions<Settings> options, IHttpClientFactory clientFactory, Fingerprints fingerprints) : BackgroundService
+{
+    private sealed record Update(long IdentityKey, string ExternalId, string Hash, byte[]? Data);
+
+    private static readonly byte[] Invalid = [];
+
+    private readonly MemoryCache cache = new(new MemoryCacheOptions() { SizeLimit = options.Value.PortraitCacheSize });
+    private readonly ConcurrentDictionary<(string ExternalId, string Hash), Update> pending = new();
+    private readonly Channel<Update> queue = Channel.CreateBounded<Update>(new BoundedChannelOptions(options.Value.PortraitQueueLength));
+    private readonly Settings settings = options.Value;
+
+    private byte[] Normalize(byte[] data)
+    {
+        try
+        {
+            using Image image = Image.Load(data);
+            if (image.Metadata.DecodedImageFormat == JpegFormat.Instance && image.Width <= settings.MaxPortraitSize.Width && image.Height <= settings.MaxPortraitSize.Height)
+            {
+                return data;
+            }
+            image.Mutate(op => op.Resize(new ResizeOptions()
+            {
+                Mode = ResizeMode.Max,
+                Sampler = KnownResamplers.Bicubic,
+                Size = settings.MaxPortraitSize,
+            }));
+            using MemoryStream outStream = new();
+            image.SaveAsJpeg(outStream);
+            return outStream.ToArray();
+        }
+        catch (ImageFormatException) { return Invalid; }
+        catch (ImageProcessingException) { return Invalid; }
+    }
+
+    private byte[] GetNormalized(string hash, byte[] data) => cache.GetOrCreate(hash, entry =>
+    {
+        byte[] normalized = Normalize(data);
+        entry.Size = Math.Max(1, normalized.Length);
+        return normalized;
+    })!;
+
+    private static async Task<bool> DeletePortraitAsync(HttpClient client, long identityKey, CancellationToken cancellationToken)
+    {
+        using HttpResponseMessage response = await client.DeleteAsync($"users/{identityKey}/portrait", cancellationToken);
+        if (response.StatusCode is HttpStatusCode.NotFound) { return false; }
+        response.EnsureSuccessStatusCode();
+        return true;
+    }
+
+    private static async Task PostPortraitAsync(HttpClient client, long identityKey, byte[] portrait, CancellationToken cancellationToken)
+    {
+        using ByteArrayContent imageContent = new(portrait);
+        imageContent.Headers.ContentType = new MediaTypeHeaderValue("image/jpeg");
+        using MultipartFormDataContent postContent = new() { { imageContent, "portrait", "portrait.jpg" } };
+        using HttpResponseMessage response = await client.PostAsync($"users/{identityKey}/portrait", postContent, cancellationToken);
+        response.EnsureSuccessStatusCode();
+    }
+
+    protected override async Task ExecuteAsync(CancellationToken stoppingToken)
+    {
+        // normalized portraits are cached by content hash, so workers don't get in each other's way
+        await Task.WhenAll(Enumerable.Range(0, Math.Max(1, settings.PortraitWorkers)).Select(_ => WorkAsync(stoppingToken)));
+    }
+
+    private async Task WorkAsync(CancellationToken stoppingToken)
+    {
+        try
+        {
+            await foreach (Update update in queue.Reader.ReadAllAsync(stoppingToken))
+            {
+                try
+                {
+                    // take a new client per update, so handler rotation of the factory applies
+                    HttpClient client = clientFactory.CreateClient(nameof(OpenOlat));
+                    byte[] portrait = update.Data is null ? Invalid : GetNormalized(update.Hash, update.Data);
+                    if (portrait == Invalid)
+                    {
+                        await DeletePortraitAsync(client, update.IdentityKey, stoppingToken);
+                    }
+                    else
+                    {
+                        await PostPortraitAsync(client, update.IdentityKey, portrait, stoppingToken);
+                    }
+                    fingerprints.SetPortrait(update.ExternalId, update.IdentityKey, update.Hash);
+                }
+                catch (Exception ex) when (!stoppingToken.IsCancellationRequested)
+                {
+                    logger.LogWarning(ex, "Update portrait of OpenOlat user {IdentityKey} failed: {Message}", update.IdentityKey, ex.Message);
+                }
+                finally
+                {
+                    pending.TryRemove((update.ExternalId, update.Hash), out _);
+                }
+            }
+        }
+        catch (OperationCanceledException ex) when (ex.CancellationToken == stoppingToken) { }
+    }
+
+    public override void Dispose()
+    {
+        base.Dispose();
+        cache.Dispose();
+    }
+
+    public void Enqueue(long identityKey, string externalId, string hash, byte[]? data)
+    {
+        Update update = new(identityKey, externalId, hash, data);
+        if (!pending.TryAdd((externalId, hash), update)) { return; }
+        if (!queue.Writer.TryWrite(update))
+        {
+            // the next logon will try again
+            pending.TryRemove((externalId, hash), out _);
+            logger.LogWarning("Portrait queue is full, skipped OpenOlat user {IdentityKey}.", identityKey);
+        }
+    }
+}
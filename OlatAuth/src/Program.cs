@@ -19,12 +19,27 @@
 using AufBauWerk.Vivendi.OlatAuth;
 using Microsoft.Extensions.Logging.Configuration;
 using Microsoft.Extensions.Logging.EventLog;
+using Microsoft.Extensions.Options;
 
 WebApplicationBuilder builder = WebApplication.CreateBuilder(args);
 LoggerProviderOptions.RegisterProviderOptions<EventLogSettings, EventLogLoggerProvider>(builder.Services);
 builder.Services
     .Configure<Settings>(builder.Configuration.GetRequiredSection("OlatAuth"))
     .AddWindowsService(options => options.ServiceName = "VivendiOlatAuth")
+    .AddSingleton<Fingerprints>()
+    .AddSingleton<Portraits>()
+    .AddHostedService(services => services.GetRequiredService<Portraits>())
+    .AddHttpClient(nameof(OpenOlat), (services, client) =>
+    {
+        Settings settings = services.GetRequiredService<IOptions<Settings>>().Value;
+        client.BaseAddress = settings.RestApiEndpoint;
+        client.DefaultRequestHeaders.Accept.Add(new("application/json"));
+    })
+    .ConfigurePrimaryHttpMessageHandler(services => new SocketsHttpHandler()
+    {
+        Credentials = services.GetRequiredService<IOptions<Settings>>().Value.Credentials,
+    })
+    .Services
     .AddControllers();
 WebApplication app = builder.Build();
 app.MapControllers();
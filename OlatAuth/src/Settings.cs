@@ -26,7 +26,12 @@ public class Settings
     public string AuthProvider { get; set; } = "TOCCO";
     public required string ConnectionString { get; set; }
     public required NetworkCredential Credentials { get; set; }
+    // upper bound for how long changes done within OpenOlat (deleted users, removed authentications) go unnoticed
+    public TimeSpan FingerprintLifetime { get; set; } = TimeSpan.FromMinutes(5);
     public required string LogonUserQuery { get; set; }
     public Size MaxPortraitSize { get; set; } = new(100, 100);
+    public long PortraitCacheSize { get; set; } = 16 * 1024 * 1024;
+    public int PortraitQueueLength { get; set; } = 1000;
+    public int PortraitWorkers { get; set; } = 4;
     public required Uri RestApiEndpoint { get; set; }
 }
@@ -0,0 +1,165 @@
+﻿/*
+ * AufBauWerk Erweiterungen für Vivendi
+ * Copyright (C) 2024  Manuel Meitinger
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+using System.IO.Pipes;
+using System.Security.AccessControl;
+using System.Security.Principal;
+
+namespace AufBauWerk.Vivendi.Syncer;
+
+internal abstract class ChannelService(string name, int instances, int concurrency, ILogger<ChannelService> logger) : BackgroundService
+{
+    private static readonly TimeSpan InstanceRestartDelay = TimeSpan.FromSeconds(1);
+
+    // requests block pool threads on account and profile work, so limit how many run at once across all instances
+    private readonly SemaphoreSlim executing = new(Math.Max(1, concurrency));
+
+    protected abstract IdentityReference ClientIdentity { get; }
+
+    protected override async Task ExecuteAsync(CancellationToken stoppingToken)
+    {
+        try
+        {
+            PipeSecurity security = new();
+            security.AddAccessRule(new(PipeService.LocalSystemSid, PipeAccessRights.FullControl, AccessControlType.Allow));
+            security.AddAccessRule(new(ClientIdentity, PipeAccessRights.ReadWrite, AccessControlType.Allow));
+            logger.LogInformation("Opening {Instances} instances of named pipe channel '{Pipe}' for client '{Identity}'.", instances, name, ClientIdentity);
+            await Task.WhenAll(Enumerable.Range(0, instances).Select(instance => ServeAsync(instance, security, stoppingToken)));
+        }
+        catch (OperationCanceledException) when (stoppingToken.IsCancellationRequested) { }
+        catch (Exception ex) { logger.LogExceptionAndExit(ex); }
+    }
+
+    private async Task ServeAsync(int instance, PipeSecurity security, CancellationToken stoppingToken)
+    {
+        while (!stoppingToken.IsCancellationRequested)
+        {
+            try
+            {
+                await ServeInstanceAsync(instance, security, stoppingToken);
+            }
+            catch (OperationCanceledException) when (stoppingToken.IsCancellationRequested) { throw; }
+            catch (Exception ex)
+            {
+                // keep the other instances running and start this one over with a new pipe
+                logger.LogError(ex, "Instance #{Instance} of named pipe channel '{Pipe}' failed: {Message}", instance, name, ex.Message);
+                await Task.Delay(InstanceRestartDelay, stoppingToken);
+            }
+        }
+    }
+
+    private async Task ServeInstanceAsync(int instance, PipeSecurity security, CancellationToken stoppingToken)
+    {
+        using NamedPipeServerStream stream = NamedPipeServerStreamAcl.Create(name, PipeDirection.InOut, instances, PipeTransmissionMode.Message, PipeOptions.Asynchronous, inBufferSize: 0, outBufferSize: 0, security);
+        using SemaphoreSlim writeLock = new(1);
+        while (!stoppingToken.IsCancellationRequested)
+        {
+            logger.LogTrace("Waiting for connection on instance #{Instance}...", instance);
+            await stream.WaitForConnectionAsync(stoppingToken);
+            logger.LogTrace("Connection on instance #{Instance} established.", instance);
+            using CancellationTokenSource connectionCts = CancellationTokenSource.CreateLinkedTokenSource(stoppingToken);
+            List<Task> running = [];
+            try
+            {
+                while (true)
+                {
+                    ChannelRequest request;
+                    try
+                    {
+                        request = await stream.ReceiveMessageAsync(SerializerContext.Default.ChannelRequest, connectionCts.Token) ?? throw new IOException("Empty request.");
+                        logger.LogTrace("Received request #{Id} on instance #{Instance} (UserName={UserName}, KnownFoldersCount={KnownFoldersCount}).", request.Id, instance, request.User.UserName, request.User.KnownFolders.Count);
+                    }
+                    catch (IOException ex)
+                    {
+                        // the client closed the channel or sent garbage, in both cases start over
+                        logger.LogTrace(ex, "Receive request on instance #{Instance} ended: {Message}", instance, ex.Message);
+                        break;
+                    }
+                    catch (OperationCanceledException ex) when (ex.CancellationToken == connectionCts.Token && !stoppingToken.IsCancellationRequested)
+                    {
+                        logger.LogTrace("Connection on instance #{Instance} dropped after a failed response.", instance);
+                        break;
+                    }
+                    running.RemoveAll(task => task.IsCompleted);
+                    running.Add(DispatchAsync(stream, writeLock, connectionCts, request, stoppingToken));
+                }
+            }
+            finally
+            {
+                await Task.WhenAll(running);
+                logger.LogTrace("Disconnecting instance #{Instance}...", instance);
+                stream.Disconnect();
+                logger.LogTrace("Disconnected instance #{Instance}.", instance);
+            }
+        }
+    }
+
+    private async Task DispatchAsync(PipeStream stream, SemaphoreSlim writeLock, CancellationTokenSource connectionCts, ChannelRequest request, CancellationToken stoppingToken)
+    {
+        // leave the receive loop before doing any work
+        await Task.Yield();
+        Result result;
+        try
+        {
+            await executing.WaitAsync(stoppingToken);
+            try
+            {
+                result = await ExecuteAsync(request.User, stoppingToken);
+            }
+            finally
+            {
+                executing.Release();
+            }
+        }
+        catch (OperationCanceledException) when (stoppingToken.IsCancellationRequested) { return; }
+        catch (Exception ex)
+        {
+            logger.LogError(ex, "Request #{Id} failed.\nPipe={Pipe}\nIsConnected={IsConnected}\n\n{Message}", request.Id, name, stream.IsConnected, ex.Message);
+            result = ex;
+        }
+        try
+        {
+            await writeLock.WaitAsync(connectionCts.Token);
+            try
+            {
+                logger.LogTrace("Sending response #{Id} (Error={Error}, UserName={UserName})...", request.Id, result.Error, result.Credential?.UserName);
+                await stream.SendMessageAsync(new ChannelResponse() { Id = request.Id, Result = result }, SerializerContext.Default.ChannelResponse, connectionCts.Token);
+                logger.LogTrace("Sent response #{Id}.", request.Id);
+            }
+            finally
+            {
+                writeLock.Release();
+            }
+        }
+        catch (OperationCanceledException) when (connectionCts.IsCancellationRequested) { }
+        catch (IOException ex)
+        {
+            // drop the connection, so the client fails all its pending requests instead of waiting forever
+            logger.LogWarning(ex, "Send response #{Id} failed: {Message}", request.Id, ex.Message);
+            connectionCts.Cancel();
+        }
+    }
+
+    public override void Dispose()
+    {
+        base.Dispose();
+        executing.Dispose();
+    }
+
+    protected abstract Task<Result> ExecuteAsync(ExternalUser externalUser, CancellationToken stoppingToken);
+}
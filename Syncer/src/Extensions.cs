@@ -49,14 +49,21 @@ public static void LogExceptionAndExit(this ILogger logger, Exception ex)
     {
         using MemoryStream memoryStream = new();
         using CancellationTokenSource cts = CancellationTokenSource.CreateLinkedTokenSource(cancellationToken);
-        cts.CancelAfter(MessageTimeout);
         try
         {
+            // wait for the start of the next message without timeout
             byte[] buffer = new byte[4096];
+            CancellationToken readToken = cancellationToken;
             do
             {
-                int read = await stream.ReadAsync(buffer, cts.Token);
+                int read = await stream.ReadAsync(buffer, readToken);
+                if (read is 0) { throw new EndOfStreamException(); }
                 memoryStream.Write(buffer, 0, read);
+                if (readToken == cancellationToken)
+                {
+                    cts.CancelAfter(MessageTimeout);
+                    readToken = cts.Token;
+                }
             } while (!stream.IsMessageComplete);
         }
         catch (OperationCanceledException ex) when (ex.CancellationToken == cts.Token)
@@ -20,11 +20,25 @@
 
 namespace AufBauWerk.Vivendi.Syncer;
 
+[JsonSerializable(typeof(ChannelRequest))]
+[JsonSerializable(typeof(ChannelResponse))]
 [JsonSerializable(typeof(Credential))]
 [JsonSerializable(typeof(ExternalUser))]
 [JsonSerializable(typeof(Result))]
 internal partial class SerializerContext : JsonSerializerContext { }
 
+internal class ChannelRequest
+{
+    [JsonRequired] public required long Id { get; set; }
+    [JsonRequired] public required ExternalUser User { get; set; }
+}
+
+internal class ChannelResponse
+{
+    [JsonRequired] public required long Id { get; set; }
+    [JsonRequired] public required Result Result { get; set; }
+}
+
 internal class Credential
 {
     [JsonRequired] public required string UserName { get; set; }
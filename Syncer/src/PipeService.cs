@@ -24,7 +24,7 @@ namespace AufBauWerk.Vivendi.Syncer;
 
 internal abstract class PipeService(string name, PipeDirection direction, ILogger<PipeService> logger) : BackgroundService
 {
-    private static readonly SecurityIdentifier LocalSystemSid = new(WellKnownSidType.LocalSystemSid, null);
+    internal static readonly SecurityIdentifier LocalSystemSid = new(WellKnownSidType.LocalSystemSid, null);
 
     protected abstract IdentityReference ClientIdentity { get; }
 
@@ -27,11 +27,13 @@
     .AddWindowsService(options => options.ServiceName = "VivendiSyncer")
     .AddSingleton<Database>()
     .AddSingleton<KnownFolders>()
-    .AddSingleton<Sessions>()
+    .AddSingleton<ISessionSource, Sessions>()
+    .AddSingleton<SessionIndex>()
     .AddSingleton<Settings>()
     .AddHostedService<CleanupService>()
     .AddHostedService<LauncherService>()
-    .AddHostedService<RemoteAppService>();
+    .AddHostedService<RemoteAppService>()
+    .AddHostedService<SessionMonitorService>();
 
 builder
     .Build()
@@ -16,16 +16,18 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+using System.Collections.Concurrent;
 using System.DirectoryServices.AccountManagement;
-using System.IO.Pipes;
 using System.Security.Principal;
 
 namespace AufBauWerk.Vivendi.Syncer;
 
-internal sealed class RemoteAppService(ILogger<RemoteAppService> logger, Settings settings, Database database, KnownFolders knownFolders, Sessions sessions) : PipeService("VivendiRemoteApp", PipeDirection.InOut, logger)
+internal sealed class RemoteAppService(ILogger<RemoteAppService> logger, Settings settings, Database database, KnownFolders knownFolders, SessionIndex sessions) : ChannelService("VivendiRemoteApp", settings.RemoteAppInstances, settings.RemoteAppConcurrency, logger)
 {
     private static readonly SecurityIdentifier BuiltinRemoteDesktopUsersSid = new(WellKnownSidType.BuiltinRemoteDesktopUsersSid, null);
 
+    private readonly ConcurrentDictionary<string, SemaphoreSlim> userLocks = new(StringComparer.OrdinalIgnoreCase);
+
     private bool UpdateUserProperties(UserPrincipal user, ExternalUser externalUser, bool checkIfNeeded)
     {
         user.AccountExpirationDate = DateTime.Now + TimeSpan.FromTicks(TimeSpan.TicksPerMinute);
@@ -51,24 +53,28 @@ private bool UpdateUserProperties(UserPrincipal user, ExternalUser externalUser,
 
     protected override IdentityReference ClientIdentity => settings.GatewayUserIdentity;
 
-    protected override async Task<Result> ExecuteAsync(NamedPipeServerStream stream, CancellationToken stoppingToken)
+    protected override async Task<Result> ExecuteAsync(ExternalUser externalUser, CancellationToken stoppingToken)
     {
-        ExternalUser externalUser;
+        string userName = externalUser.UserName;
+        int separator = userName.LastIndexOf('@');
+        if (-1 < separator) { userName = userName[..separator]; }
+        if (!await database.IsVivendiUserAsync(userName, stoppingToken)) { return null as Credential; }
+
+        // requests are handled concurrently, but only one at a time per Windows user
+        SemaphoreSlim userLock = userLocks.GetOrAdd(userName, _ => new(1));
+        await userLock.WaitAsync(stoppingToken);
         try
         {
-            logger.LogTrace("Receiving request...");
-            externalUser = await stream.ReceiveMessageAsync(SerializerContext.Default.ExternalUser, stoppingToken) ?? throw new InvalidDataException();
-            logger.LogTrace("Received request (UserName={UserName}, KnownFoldersCount={KnownFoldersCount}).", externalUser.UserName, externalUser.KnownFolders.Count);
+            return SetupUser(userName, externalUser);
         }
-        catch (IOException ex)
+        finally
         {
-            logger.LogWarning(ex, "Receive request from pipe failed: {Message}", ex.Message);
-            return ex;
+            userLock.Release();
         }
-        string userName = externalUser.UserName;
-        int separator = userName.LastIndexOf('@');
-        if (-1 < separator) { userName = userName[..separator]; }
-        if (!await database.IsVivendiUserAsync(userName, stoppingToken)) { return null as Credential; }
+    }
+
+    private Result SetupUser(string userName, ExternalUser externalUser)
+    {
         string password = new(Random.Shared.GetItems(settings.PasswordChars, settings.PasswordLength));
         logger.LogTrace("Generated password containing {Length} characters.", password.Length);
         using PrincipalContext context = new(ContextType.Machine);
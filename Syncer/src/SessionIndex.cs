@@ -0,0 +1,100 @@
+﻿/*
+ * AufBauWerk Erweiterungen für Vivendi
+ * Copyright (C) 2024  Manuel Meitinger
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+using System.Diagnostics.CodeAnalysis;
+using System.DirectoryServices.AccountManagement;
+using System.Security.Principal;
+
+namespace AufBauWerk.Vivendi.Syncer;
+
+internal interface ISessionSource
+{
+    bool TryEnumerateActiveSessions([NotNullWhen(true)] out uint[]? sessionIds);
+    bool TryGetSid(uint sessionId, [NotNullWhen(true)] out SecurityIdentifier? sid);
+    bool Disconnect(uint sessionId, bool wait);
+    bool WaitForChange(TimeSpan timeout, CancellationToken cancellationToken);
+}
+
+internal sealed class SessionIndex(ILogger<SessionIndex> logger, ISessionSource source)
+{
+    private sealed record Snapshot(IReadOnlyDictionary<uint, SecurityIdentifier> SidBySession, IReadOnlyDictionary<SecurityIdentifier, uint[]> SessionsBySid);
+
+    private readonly Lock refreshLock = new();
+    private volatile Snapshot? snapshot;
+
+    public IReadOnlyCollection<uint> GetSessions(SecurityIdentifier sid)
+    {
+        Snapshot current = snapshot ?? Update(full: true);
+        return current.SessionsBySid.TryGetValue(sid, out uint[]? sessionIds) ? sessionIds : [];
+    }
+
+    public void Refresh(bool full) => Update(full);
+
+    private Snapshot Update(bool full)
+    {
+        lock (refreshLock)
+        {
+            Snapshot? previous = snapshot;
+            if (!source.TryEnumerateActiveSessions(out uint[]? sessionIds))
+            {
+                // keep the last known state, the next resync will try again
+                return previous ?? new(new Dictionary<uint, SecurityIdentifier>(), new Dictionary<SecurityIdentifier, uint[]>());
+            }
+            Dictionary<uint, SecurityIdentifier> sidBySession = new(sessionIds.Length);
+            foreach (uint sessionId in sessionIds)
+            {
+                // session IDs are only reused after a session ended, which is caught by the notification or the next full resync
+                if (!full && previous is not null && previous.SidBySession.TryGetValue(sessionId, out SecurityIdentifier? knownSid))
+                {
+                    sidBySession.Add(sessionId, knownSid);
+                }
+                else if (source.TryGetSid(sessionId, out SecurityIdentifier? sid))
+                {
+                    sidBySession.Add(sessionId, sid);
+                }
+            }
+            bool unmodified =
+                previous is not null &&
+                previous.SidBySession.Count == sidBySession.Count &&
+                sidBySession.All(entry => previous.SidBySession.TryGetValue(entry.Key, out SecurityIdentifier? sid) && sid == entry.Value);
+            if (unmodified) { return previous!; }
+            Snapshot current = new(sidBySession, sidBySession.GroupBy(entry => entry.Value, entry => entry.Key).ToDictionary(group => group.Key, group => group.ToArray()));
+            snapshot = current;
+            logger.LogTrace("Indexed {Count} active terminal sessions of {UserCount} users.", sidBySession.Count, current.SessionsBySid.Count);
+            return current;
+        }
+    }
+
+    public void DisconnectForUser(UserPrincipal user, bool wait)
+    {
+        if (user.Sid is not SecurityIdentifier userSid) { return; }
+        foreach (uint sessionId in GetSessions(userSid))
+        {
+            // verify the indexed owner, in case the session got reused since the last refresh
+            if (!source.TryGetSid(sessionId, out SecurityIdentifier? sid) || sid != userSid)
+            {
+                logger.LogTrace("Terminal session #{SessionId} no longer belongs to Windows user '{User}'.", sessionId, user.Name);
+                continue;
+            }
+            if (source.Disconnect(sessionId, wait))
+            {
+                logger.LogTrace("Disconnected Windows user '{User}' from terminal session #{SessionId}.", user.Name, sessionId);
+            }
+        }
+    }
+}
@@ -0,0 +1,48 @@
+﻿/*
+ * AufBauWerk Erweiterungen für Vivendi
+ * Copyright (C) 2024  Manuel Meitinger
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+namespace AufBauWerk.Vivendi.Syncer;
+
+internal sealed class SessionMonitorService(ILogger<SessionMonitorService> logger, Settings settings, ISessionSource source, SessionIndex index) : BackgroundService
+{
+    private void Run(CancellationToken stoppingToken)
+    {
+        DateTime nextFull = DateTime.MinValue;
+        while (!stoppingToken.IsCancellationRequested)
+        {
+            // events may be missed between waits, so resync everything on a fixed schedule regardless of event traffic
+            DateTime now = DateTime.UtcNow;
+            bool full = nextFull <= now;
+            if (full) { nextFull = now + settings.SessionResyncInterval; }
+            logger.LogTrace("Refreshing terminal session index (Full={Full})...", full);
+            index.Refresh(full);
+            TimeSpan timeout = nextFull - DateTime.UtcNow;
+            source.WaitForChange(timeout < TimeSpan.Zero ? TimeSpan.Zero : timeout, stoppingToken);
+        }
+    }
+
+    protected override async Task ExecuteAsync(CancellationToken stoppingToken)
+    {
+        try
+        {
+            await Task.Factory.StartNew(() => Run(stoppingToken), stoppingToken, TaskCreationOptions.LongRunning, TaskScheduler.Default);
+        }
+        catch (OperationCanceledException ex) when (ex.CancellationToken == stoppingToken) { }
+        catch (Exception ex) { logger.LogExceptionAndExit(ex); }
+    }
+}
@@ -17,18 +17,20 @@
  */
 
 using System.Diagnostics.CodeAnalysis;
-using System.DirectoryServices.AccountManagement;
 using System.Runtime.InteropServices;
 using System.Security.Principal;
 
 namespace AufBauWerk.Vivendi.Syncer;
 
-internal unsafe partial class Sessions(ILogger<Sessions> logger)
+internal unsafe partial class Sessions(ILogger<Sessions> logger) : ISessionSource
 {
     #region Win32
 
     private const int ERROR_INSUFFICIENT_BUFFER = 122;
     private const nint WTS_CURRENT_SERVER_HANDLE = 0;
+    private const uint WTS_EVENT_ALL = 0x7FFFFFFF;
+    private const uint WTS_EVENT_FLUSH = 0x01000000;
+    private const uint WTS_EVENT_NONE = 0x00000000;
 
     [LibraryImport("kernel32.dll", SetLastError = true)]
     [return: MarshalAs(UnmanagedType.Bool)]
@@ -38,7 +40,7 @@ internal unsafe partial class Sessions(ILogger<Sessions> logger)
     [return: MarshalAs(UnmanagedType.Bool)]
     private static partial bool GetTokenInformation(nint tokenHandle, TOKEN_INFORMATION_CLASS tokenInformationClass, void* tokenInformation, uint tokenInformationLength, uint* returnLength);
 
-    [LibraryImport("wtsapi32.dll")]
+    [LibraryImport("wtsapi32.dll", SetLastError = true)]
     [return: MarshalAs(UnmanagedType.Bool)]
     private static partial bool WTSDisconnectSession(nint server, uint sessionId, [MarshalAs(UnmanagedType.Bool)] bool wait);
 
@@ -54,6 +56,10 @@ internal unsafe partial class Sessions(ILogger<Sessions> logger)
     [return: MarshalAs(UnmanagedType.Bool)]
     private static partial bool WTSQueryUserToken(uint sessionId, nint* token);
 
+    [LibraryImport("wtsapi32.dll", SetLastError = true)]
+    [return: MarshalAs(UnmanagedType.Bool)]
+    private static partial bool WTSWaitSystemEvent(nint server, uint eventMask, uint* eventFlags);
+
     private enum TOKEN_INFORMATION_CLASS { TokenUser = 1 };
 
     private enum WTS_CONNECTSTATE_CLASS { Active = 0 }
@@ -80,7 +86,9 @@ private struct WTS_SESSION_INFOW
 
     #endregion
 
-    private bool TryGetSidFromSession(uint sessionId, [NotNullWhen(true)] out SecurityIdentifier? sid)
+    private static readonly TimeSpan FlushRetryInterval = TimeSpan.FromMilliseconds(100);
+
+    public bool TryGetSid(uint sessionId, [NotNullWhen(true)] out SecurityIdentifier? sid)
     {
         nint token = 0;
         try
@@ -133,7 +141,7 @@ private bool TryGetSidFromSession(uint sessionId, [NotNullWhen(true)] out Securi
         }
     }
 
-    public void DisconnectForUser(UserPrincipal user, bool wait)
+    public bool TryEnumerateActiveSessions([NotNullWhen(true)] out uint[]? sessionIds)
     {
         WTS_SESSION_INFOW* sessionInfos = null;
         uint count = 0;
@@ -144,25 +152,21 @@ public void DisconnectForUser(UserPrincipal user, bool wait)
             {
                 // this should not happen
                 logger.LogError("Enumerate terminal sessions failed: {Message}", Marshal.GetLastPInvokeErrorMessage());
-                return;
+                sessionIds = null;
+                return false;
             }
+            List<uint> activeSessionIds = new((int)count);
             for (uint i = 0; i < count; i++)
             {
                 WTS_SESSION_INFOW sessionInfo = sessionInfos[i];
-                if (sessionInfo.State is not WTS_CONNECTSTATE_CLASS.Active || !TryGetSidFromSession(sessionInfo.SessionId, out var sid) || sid != user.Sid)
+                if (sessionInfo.State is WTS_CONNECTSTATE_CLASS.Active)
                 {
-                    continue;
-                }
-                if (!WTSDisconnectSession(WTS_CURRENT_SERVER_HANDLE, sessionInfo.SessionId, wait))
-                {
-                    logger.LogWarning("Disconnect Windows user '{User}' from terminal session #{SessionId} failed: {Message}", user.Name, sessionInfo.SessionId, Marshal.GetLastPInvokeErrorMessage());
-                }
-                else
-                {
-                    logger.LogTrace("Disconnected Windows user '{User}' from terminal sessions #{SessionId}.", user.Name, sessionInfo.SessionId);
+                    activeSessionIds.Add(sessionInfo.SessionId);
                 }
             }
             logger.LogTrace("Enumerated {Count} terminal sessions.", count);
+            sessionIds = [.. activeSessionIds];
+            return true;
         }
         finally
         {
@@ -172,4 +176,48 @@ public void DisconnectForUser(UserPrincipal user, bool wait)
             }
         }
     }
+
+    public bool Disconnect(uint sessionId, bool wait)
+    {
+        if (!WTSDisconnectSession(WTS_CURRENT_SERVER_HANDLE, sessionId, wait))
+        {
+            logger.LogWarning("Disconnect terminal session #{SessionId} failed: {Message}", sessionId, Marshal.GetLastPInvokeErrorMessage());
+            return false;
+        }
+        return true;
+    }
+
+    public bool WaitForChange(TimeSpan timeout, CancellationToken cancellationToken)
+    {
+        uint eventFlags = WTS_EVENT_NONE;
+        int returned = 0;
+        Timer? flusher = null;
+        using CancellationTokenSource cts = CancellationTokenSource.CreateLinkedTokenSource(cancellationToken);
+        cts.CancelAfter(timeout);
+
+        // a flush only releases a wait that already blocks, so keep flushing until the wait actually returned
+        using (cts.Token.Register(() => flusher = new(_ => { if (Volatile.Read(ref returned) is 0) { Flush(); } }, null, TimeSpan.Zero, FlushRetryInterval)))
+        {
+            if (!cts.IsCancellationRequested && !WTSWaitSystemEvent(WTS_CURRENT_SERVER_HANDLE, WTS_EVENT_ALL, &eventFlags) && !cts.IsCancellationRequested)
+            {
+                // this should not happen
+                logger.LogError("Wait for terminal session event failed: {Message}", Marshal.GetLastPInvokeErrorMessage());
+                cts.Token.WaitHandle.WaitOne();
+            }
+            Volatile.Write(ref returned, 1);
+        }
+        flusher?.Dispose();
+        cancellationToken.ThrowIfCancellationRequested();
+        return eventFlags is not WTS_EVENT_NONE;
+
+        void Flush()
+        {
+            uint flushFlags;
+            if (!WTSWaitSystemEvent(WTS_CURRENT_SERVER_HANDLE, WTS_EVENT_FLUSH, &flushFlags))
+            {
+                // this should never happen
+                logger.LogCritical("Flush terminal session event wait failed: {Message}", Marshal.GetLastPInvokeErrorMessage());
+            }
+        }
+    }
 }
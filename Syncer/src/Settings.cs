@@ -54,6 +54,9 @@ private static IdentityReference GetIdentity(string nameOrSid)
     public char[] PasswordChars => Get(DefaultPasswordChars);
     public int PasswordLength => Get(25);
     public string QueryString => Get<string>();
+    public int RemoteAppConcurrency => Get(4);
+    public int RemoteAppInstances => Get(4);
+    public TimeSpan SessionResyncInterval => Get(TimeSpan.FromMinutes(5));
     private string SyncGroup => Get<string>();
     public IdentityReference SyncGroupIdentity => GetIdentity(SyncGroup);
     public string UserDescription => Get("");